@@ -34,15 +34,357 @@
 #include <unordered_map>
 #include <type_traits>
 #include <utility>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <future>
+#include <unordered_set>
+#include <atomic>
+#include <deque>
+#include <memory>
+#if defined(CACHEIT_STATS) || defined(CACHEIT_TRACE)
+#include <cstdio>
+#include <fstream>
+#endif
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<source_location>)
+#include <source_location>
+#endif
+#if __has_include(<coroutine>)
+#include <coroutine>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CACHEIT_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define CACHEIT_PREFETCH(p) ((void)0)
+#endif
 
 // ID mode uses a dense table and has add/remove option (didn't add remove_if and add_if as you can just do that by looping and using add or remove)
 // Grouping mode uses a vector of buckets (changed from umap to remove hash overhead)
 
-template<typename T, typename Category = int, typename Categorizer = void>
+/*
+* Stats: build with -DCACHEIT_STATS and every cache counts its updates/adds/removes and
+* times how long it waits for its locks (relaxed atomics, no extra locking on the hot path).
+* Sizes are mirrored the same way, so reading stats() never takes the cache lock.
+* CacheItExporter renders any number of named caches as OpenMetrics text.
+*/
+#ifdef CACHEIT_STATS
+#define CACHEIT_COUNT(field) stats_.field.fetch_add(1, std::memory_order_relaxed)
+
+// lock wait histogram, fixed buckets in nanoseconds
+struct CacheItLockHistogram {
+    static constexpr size_t buckets = 12;
+    static constexpr uint64_t bounds_ns[buckets] = {100, 250, 500, 1000, 2500, 5000, 10000,
+                                                    25000, 50000, 100000, 250000, 1000000};
+    std::atomic<uint64_t> counts[buckets + 1] = {}; // last one is +Inf
+    std::atomic<uint64_t> sum_ns{0};
+
+    void record(std::chrono::steady_clock::duration d) {
+        uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+        size_t i = 0;
+        while (i < buckets && ns > bounds_ns[i]) ++i;
+        counts[i].fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    struct Snapshot {
+        uint64_t counts[buckets + 1] = {};
+        uint64_t sum_ns = 0;
+    };
+
+    void copy_to(Snapshot& out) const {
+        for (size_t i = 0; i <= buckets; ++i) out.counts[i] = counts[i].load(std::memory_order_relaxed);
+        out.sum_ns = sum_ns.load(std::memory_order_relaxed);
+    }
+};
+
+struct CacheItStats {
+    uint64_t size = 0;
+    uint64_t memory_bytes = 0; // estimate from container capacities
+    uint64_t updates = 0, adds = 0, removes = 0;
+    std::vector<std::pair<std::string, uint64_t>> categories;
+    CacheItLockHistogram::Snapshot read_wait, write_wait;
+};
+#else
+#define CACHEIT_COUNT(field) ((void)0)
+#endif
+
+/*
+* Tracing: build with -DCACHEIT_TRACE and update() phases plus every lock wait are recorded
+* as spans in per-thread ring buffers. CacheItTrace::write("trace.json") dumps them in
+* Chrome trace event format, which chrome://tracing and ui.perfetto.dev open directly.
+*/
+#ifdef CACHEIT_TRACE
+class CacheItTrace {
+public:
+    static constexpr size_t ring_capacity = 1 << 14; // spans kept per thread, oldest overwritten
+
+    struct Span {
+        const char* name;
+        int64_t begin_ns;
+        int64_t end_ns;
+    };
+
+    static void record(const char* name, int64_t begin_ns, int64_t end_ns) {
+        Ring& r = local_ring();
+        std::lock_guard lock(r.mutex); // only contended while a dump is running
+        r.spans[r.next % ring_capacity] = {name, begin_ns, end_ns};
+        ++r.next;
+    }
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static std::string render() {
+        std::string out = "{\"traceEvents\":[";
+        bool first = true;
+        char buf[256];
+        std::lock_guard rlock(registry().mutex);
+        for (auto const& r : registry().rings) {
+            std::lock_guard lock(r->mutex);
+            size_t count = std::min<size_t>(r->next, ring_capacity);
+            for (size_t i = r->next - count; i < r->next; ++i) {
+                const Span& sp = r->spans[i % ring_capacity];
+                std::snprintf(buf, sizeof(buf),
+                              "%s{\"name\":\"%s\",\"cat\":\"cacheit\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+                              "\"ts\":%.3f,\"dur\":%.3f}",
+                              first ? "" : ",", sp.name, r->tid,
+                              sp.begin_ns / 1000.0, (sp.end_ns - sp.begin_ns) / 1000.0);
+                out += buf;
+                first = false;
+            }
+        }
+        out += "]}\n";
+        return out;
+    }
+
+    static bool write(const std::string& path) {
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        f << render();
+        return static_cast<bool>(f);
+    }
+
+    // drops everything recorded so far
+    static void reset() {
+        std::lock_guard rlock(registry().mutex);
+        for (auto const& r : registry().rings) {
+            std::lock_guard lock(r->mutex);
+            r->next = 0;
+        }
+    }
+
+private:
+    struct Ring {
+        std::mutex mutex;
+        size_t tid = 0;
+        size_t next = 0;
+        std::vector<Span> spans = std::vector<Span>(ring_capacity);
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Ring>> rings; // outlive their threads so late dumps still see them
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    static Ring& local_ring() {
+        thread_local std::shared_ptr<Ring> ring = [] {
+            auto r = std::make_shared<Ring>();
+            std::lock_guard lock(registry().mutex);
+            r->tid = registry().rings.size() + 1;
+            registry().rings.push_back(r);
+            return r;
+        }();
+        return *ring;
+    }
+};
+
+// records [construction, destruction) as one span
+class CacheItTraceSpan {
+public:
+    explicit CacheItTraceSpan(const char* name) : name_(name), begin_(CacheItTrace::now_ns()) {}
+    ~CacheItTraceSpan() { CacheItTrace::record(name_, begin_, CacheItTrace::now_ns()); }
+    CacheItTraceSpan(const CacheItTraceSpan&) = delete;
+    CacheItTraceSpan& operator=(const CacheItTraceSpan&) = delete;
+
+private:
+    const char* name_;
+    int64_t begin_;
+};
+
+#define CACHEIT_TRACE_CONCAT2(a, b) a##b
+#define CACHEIT_TRACE_CONCAT(a, b) CACHEIT_TRACE_CONCAT2(a, b)
+#define CACHEIT_TRACE_SPAN(name) CacheItTraceSpan CACHEIT_TRACE_CONCAT(cacheit_span_, __LINE__)(name)
+#else
+#define CACHEIT_TRACE_SPAN(name) ((void)0)
+#endif
+
+// call site captured by default arguments, std::source_location when the library has it
+#if defined(__cpp_lib_source_location)
+using CacheItCallSite = std::source_location;
+#else
+struct CacheItCallSite {
+    static CacheItCallSite current(const char* file = __builtin_FILE(), const char* fn = __builtin_FUNCTION(),
+                                   unsigned line = __builtin_LINE()) {
+        CacheItCallSite s;
+        s.file_ = file;
+        s.fn_ = fn;
+        s.line_ = line;
+        return s;
+    }
+    const char* file_name() const { return file_; }
+    const char* function_name() const { return fn_; }
+    unsigned line() const { return line_; }
+
+private:
+    const char* file_ = "";
+    const char* fn_ = "";
+    unsigned line_ = 0;
+};
+#endif
+
+// one over-budget lock hold seen by the watchdog
+struct CacheItLockHold {
+    const char* op;
+    const char* file;
+    const char* function;
+    unsigned line;
+    std::chrono::nanoseconds held;
+};
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_lib_coroutine)
+#define CACHEIT_HAS_COROUTINES 1
+
+/*
+* Minimal std::generator stand-in for co_iterate()/co_iterate_all(): range-for over it,
+* resume happens on ++. Frames come from a small per-thread pool since these are created
+* every frame with the same size.
+*/
+template<typename V>
+class CacheItGenerator {
+public:
+    struct promise_type {
+        V current{};
+
+        CacheItGenerator get_return_object() {
+            return CacheItGenerator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(V v) noexcept {
+            current = v;
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { throw; }
+
+        static void* operator new(size_t size) {
+            auto& pool = frame_pool();
+            for (size_t i = 0; i < pool.size(); ++i) {
+                if (pool[i].first == size) {
+                    void* p = pool[i].second;
+                    pool[i] = pool.back();
+                    pool.pop_back();
+                    return p;
+                }
+            }
+            return ::operator new(size);
+        }
+
+        static void operator delete(void* p, size_t size) {
+            auto& pool = frame_pool();
+            if (pool.size() < 16) pool.emplace_back(size, p);
+            else ::operator delete(p);
+        }
+    };
+
+    struct sentinel {};
+
+    class iterator {
+    public:
+        explicit iterator(std::coroutine_handle<promise_type> h) : h_(h) {}
+        V operator*() const { return h_.promise().current; }
+        iterator& operator++() {
+            h_.resume();
+            return *this;
+        }
+        bool operator==(sentinel) const { return h_.done(); }
+        bool operator!=(sentinel) const { return !h_.done(); }
+
+    private:
+        std::coroutine_handle<promise_type> h_;
+    };
+
+    CacheItGenerator(CacheItGenerator&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    CacheItGenerator& operator=(CacheItGenerator&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    ~CacheItGenerator() { if (h_) h_.destroy(); }
+
+    iterator begin() {
+        h_.resume();
+        return iterator(h_);
+    }
+    sentinel end() { return {}; }
+
+private:
+    explicit CacheItGenerator(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+    // frames freed on this thread, kept for reuse (blocks are only handed to same-size frames)
+    struct FramePool : std::vector<std::pair<size_t, void*>> {
+        ~FramePool() { for (auto& b : *this) ::operator delete(b.second); }
+    };
+    static FramePool& frame_pool() {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    std::coroutine_handle<promise_type> h_;
+};
+#endif
+
+// default category hash/equality, std::string categories get transparent ones so
+// for_each("Player", ...) or a std::string_view can look up without building a std::string
+// (needs C++20 heterogeneous unordered lookup, C++17 builds convert the key instead)
+template<typename Category>
+struct CacheItHash : std::hash<Category> {};
+
+template<>
+struct CacheItHash<std::string> {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); }
+};
+
+template<typename Category>
+using CacheItKeyEqual = std::conditional_t<std::is_same_v<Category, std::string>,
+                                           std::equal_to<>, std::equal_to<Category>>;
+
+template<typename T, typename Category = int, typename Categorizer = void,
+         typename Hash = CacheItHash<Category>, typename KeyEqual = CacheItKeyEqual<Category>>
 class CacheIt {
 public:
     using u64 = uint64_t;
+    using value_type = T;
+    using category_type = Category;
     static constexpr bool grouping_enabled = !std::is_same_v<Categorizer, void>;
+    using category_map = std::unordered_map<Category, size_t, Hash, KeyEqual>;
+    // category computed outside the lock and handed to the *_locked helpers (unused in ID mode)
+    using stored_category = std::conditional_t<grouping_enabled, Category, char>;
 
     // id mode ctor
     CacheIt() {
@@ -57,34 +399,60 @@ public:
 
     // full rebuild
     void update(const std::vector<T*>& entities) {
+        CACHEIT_COUNT(updates);
+        // O(n) id copy for the delta log, take_delta() sorts and encodes it
+        std::vector<u64> delta_ids;
+        bool log = delta_enabled_.load(std::memory_order_relaxed);
+        if (log) {
+            delta_ids.reserve(entities.size());
+            for (auto* e : entities) delta_ids.push_back(static_cast<u64>(e->id));
+        }
         if constexpr (grouping_enabled) {
             // grouping mode:
             // changed from umap to vector of buckets
-            std::unordered_map<Category, size_t> local_index;
+            category_map local_index;
             std::vector<Category> local_categories;
             local_index.reserve(entities.size());
 
-            for (auto* e : entities) {
-                Category c = categorizer_(e);
-                if (!local_index.count(c)) {
-                    local_index[c] = local_categories.size();
-                    local_categories.push_back(c);
+            {
+                CACHEIT_TRACE_SPAN("update.categorize");
+                for (auto* e : entities) {
+                    Category c = categorizer_(e);
+                    if (!local_index.count(c)) {
+                        local_index[c] = local_categories.size();
+                        local_categories.push_back(c);
+                    }
                 }
             }
 
             std::vector<std::vector<T*>> local_buckets(local_categories.size());
-            size_t avg = local_categories.empty() ? 0 : entities.size() / local_categories.size();
-            for (auto& b : local_buckets) b.reserve(avg);
+            {
+                CACHEIT_TRACE_SPAN("update.scatter");
+                size_t avg = local_categories.empty() ? 0 : entities.size() / local_categories.size();
+                for (auto& b : local_buckets) b.reserve(avg);
+
+                for (auto* e : entities) {
+                    size_t idx = local_index[categorizer_(e)];
+                    local_buckets[idx].push_back(e);
+                }
+            }
 
-            for (auto* e : entities) {
-                size_t idx = local_index[categorizer_(e)];
-                local_buckets[idx].push_back(e);
+            {
+                auto lock = write_lock(grouping_mutex_);
+                CACHEIT_TRACE_SPAN("update.swap");
+                category_to_index_.swap(local_index);
+                categories_.swap(local_categories);
+                buckets_.swap(local_buckets);
+                bump_all_buckets();
+                ++generation_;
+                if (log) defer_reset(delta_ids);
             }
 
-            std::unique_lock lock(grouping_mutex_);
-            category_to_index_.swap(local_index);
-            categories_.swap(local_categories);
-            buckets_.swap(local_buckets);
+            // old state is freed outside the lock
+            CACHEIT_TRACE_SPAN("update.destroy");
+            local_buckets = std::vector<std::vector<T*>>();
+            local_categories = std::vector<Category>();
+            local_index = category_map();
         } else {
             // ID mode:
             std::vector<T*> local_table;
@@ -94,23 +462,75 @@ public:
             local_ids.reserve(entities.size());
             local_idx_map.reserve(entities.size());
 
-            for (auto* e : entities) {
-                u64 id = static_cast<u64>(e->id);
-                if (id >= local_table.size())
-                    local_table.resize(id + 1, nullptr);
-                local_table[id] = e;
-                size_t pos = local_ids.size();
-                local_ids.push_back(id);
-                local_idx_map[id] = pos;
+            {
+                CACHEIT_TRACE_SPAN("update.scatter");
+                for (auto* e : entities) {
+                    u64 id = static_cast<u64>(e->id);
+                    if (id >= local_table.size())
+                        local_table.resize(id + 1, nullptr);
+                    local_table[id] = e;
+                    size_t pos = local_ids.size();
+                    local_ids.push_back(id);
+                    local_idx_map[id] = pos;
+                }
+            }
+
+            {
+                auto lock = write_lock(id_mutex_);
+                CACHEIT_TRACE_SPAN("update.swap");
+                table_.swap(local_table);
+                active_ids_.swap(local_ids);
+                id_to_index_.swap(local_idx_map);
+                ++generation_;
+                mirror_all();
+                if (log) defer_reset(delta_ids);
             }
 
-            std::unique_lock lock(id_mutex_);
-            table_.swap(local_table);
-            active_ids_.swap(local_ids);
-            id_to_index_.swap(local_idx_map);
+            // old state is freed outside the lock
+            CACHEIT_TRACE_SPAN("update.destroy");
+            local_table = std::vector<T*>();
+            local_ids = std::vector<u64>();
+            local_idx_map = std::unordered_map<u64, size_t>();
+        }
+    }
+
+    /*
+    * Time-sliced rebuild, same result as update() but spread over several frames:
+        cache.begin_update(actors);          // takes its own copy of the list
+        // every frame:
+        if (cache.step(std::chrono::microseconds(500))) { ... published ... }
+    * Readers keep seeing the previous full state until the pass completes,
+    * then it's swapped in under one lock like update().
+    * begin_update/step are meant to be driven by one writer thread, and an
+    * add/remove made while a pass is pending is overwritten when it publishes.
+    * The copy is of pointers: every entity in it has to stay alive until the pass publishes
+    * (later step()s call the categorizer on them, and the publish hands them to readers).
+    * If something despawns mid-pass, call begin_update() again with the new list.
+    */
+    void begin_update(std::vector<T*> entities) {
+        pending_ = PendingUpdate{};
+        pending_.entities = std::move(entities);
+        pending_.active = true;
+        pending_.log = delta_enabled_.load(std::memory_order_relaxed);
+        if (pending_.log) pending_.delta_ids.reserve(pending_.entities.size());
+        if constexpr (!grouping_enabled) {
+            pending_.ids.reserve(pending_.entities.size());
+            pending_.idx_map.reserve(pending_.entities.size());
         }
     }
 
+    // process at most max_entities, returns true once the pass is published
+    bool step(size_t max_entities) {
+        return step_impl(max_entities, {}, false);
+    }
+
+    // process until the budget is spent, returns true once the pass is published
+    bool step(std::chrono::microseconds budget) {
+        return step_impl(SIZE_MAX, std::chrono::steady_clock::now() + budget, true);
+    }
+
+    bool update_pending() const { return pending_.active; }
+
     /*
     * You can use add and remove by doing something like
         diff_snapshots(prev_actors, curr_actors, to_add, to_remove); // sorts + set_difference
@@ -122,88 +542,313 @@ public:
 
     // O(1) add
     void add(T* e) {
-        u64 id = static_cast<u64>(e->id);
+        CACHEIT_COUNT(adds);
         if constexpr (grouping_enabled) {
             Category c = categorizer_(e);
-            std::unique_lock lock(grouping_mutex_);
-            auto it = category_to_index_.find(c);
-            if (it == category_to_index_.end()) {
-                size_t idx = categories_.size();
-                category_to_index_[c] = idx;
-                categories_.push_back(c);
-                buckets_.emplace_back();
-            }
-            buckets_[category_to_index_[c]].push_back(e);
+            auto lock = write_lock(grouping_mutex_);
+            add_locked(e, c);
         } else {
-            std::unique_lock lock(id_mutex_);
-            if (id_to_index_.count(id)) return; // avoid duplicates
-            if (id >= table_.size())
-                table_.resize(id + 1, nullptr);
-            table_[id] = e;
-            size_t pos = active_ids_.size();
-            active_ids_.push_back(id);
-            id_to_index_[id] = pos;
+            auto lock = write_lock(id_mutex_);
+            add_locked(e, 0);
         }
     }
 
     // O(1) remove
     void remove(T* e) {
-        u64 id = static_cast<u64>(e->id);
+        CACHEIT_COUNT(removes);
         if constexpr (grouping_enabled) {
             Category c = categorizer_(e);
-            std::unique_lock lock(grouping_mutex_);
-            auto it = category_to_index_.find(c);
-            if (it == category_to_index_.end()) return;
-            auto& vec = buckets_[it->second];
-            if (auto pos = std::find(vec.begin(), vec.end(), e); pos != vec.end()) {
-                std::iter_swap(pos, vec.end() - 1);
-                vec.pop_back();
-            }
+            auto lock = write_lock(grouping_mutex_);
+            remove_locked(e, c);
         } else {
-            std::unique_lock lock(id_mutex_);
-            auto it = id_to_index_.find(id);
-            if (it == id_to_index_.end()) return;
-            size_t idx = it->second;
-            size_t last = active_ids_.size() - 1;
-            u64 back_id = active_ids_[last];
-            std::swap(active_ids_[idx], active_ids_[last]);
-            active_ids_.pop_back();
-            id_to_index_[back_id] = idx;
-            id_to_index_.erase(it);
-            if (id < table_.size()) table_[id] = nullptr;
+            auto lock = write_lock(id_mutex_);
+            remove_locked(e, 0);
+        }
+    }
+
+    /*
+    * Batch of adds/removes that readers see all at once or not at all:
+        auto tx = cache.transaction();
+        tx.add(spawned);
+        tx.remove(despawned);
+        tx.commit();   // one lock, cost proportional to the batch
+    * Nothing touches the cache before commit(), so rollback() (or dropping tx) just forgets the ops.
+    * Categories are computed when ops are staged, outside the lock.
+    * commit() throws std::logic_error and applies nothing if an op hits a thread-owned category
+    * (see own()), those only change when their owner publishes.
+    */
+    class Transaction {
+    public:
+        explicit Transaction(CacheIt& cache) : cache_(&cache) {}
+
+        void add(T* e) { ops_.push_back(stage(e, true)); }
+        void remove(T* e) { ops_.push_back(stage(e, false)); }
+
+        void commit() {
+            if (ops_.empty()) return;
+            size_t adds = 0;
+            {
+                auto lock = cache_->write_lock(cache_->mode_mutex());
+                if constexpr (grouping_enabled) {
+                    for (auto const& op : ops_) {
+                        if (cache_->owned_.count(op.cat))
+                            throw std::logic_error("CacheIt::Transaction: category is owned by a thread");
+                    }
+                }
+                for (auto const& op : ops_) {
+                    if (op.add) {
+                        cache_->add_locked(op.e, op.cat);
+                        ++adds;
+                    } else {
+                        cache_->remove_locked(op.e, op.cat);
+                    }
+                }
+            }
+#ifdef CACHEIT_STATS
+            cache_->stats_.adds.fetch_add(adds, std::memory_order_relaxed);
+            cache_->stats_.removes.fetch_add(ops_.size() - adds, std::memory_order_relaxed);
+#endif
+            ops_.clear();
+        }
+
+        void rollback() { ops_.clear(); }
+
+        size_t size() const { return ops_.size(); }
+
+    private:
+        struct Op {
+            T* e;
+            bool add;
+            stored_category cat;
+        };
+
+        Op stage(T* e, bool add) const {
+            if constexpr (grouping_enabled) return Op{e, add, cache_->categorizer_(e)};
+            else return Op{e, add, 0};
+        }
+
+        CacheIt* cache_;
+        std::vector<Op> ops_;
+    };
+
+    Transaction transaction() { return Transaction(*this); }
+
+    /*
+    * A category (grouping mode) handed to one thread, which then mutates it without taking the lock:
+        auto& players = grp_cache.own("Player");   // from the owning thread
+        players.add(spawned);                      // owner thread only, no lock
+        players.remove(despawned);
+        players.publish();                         // once per frame, O(1) under the lock
+    * Readers keep seeing the last published bucket until publish().
+    * publish() swaps the staged vector in and keeps the old one as the next staging base, it's
+    * brought up to date by replaying this frame's ops outside the lock.
+    * add()/remove() from any thread for an owned category still take the cache lock, they're
+    * queued in the owner's inbox and applied at its next publish().
+    * Transactions can't be all-or-nothing across an owner's publish, so commit() rejects them.
+    * A full update()/clear() wins over edits that weren't published yet.
+    * Cursors over the bucket are clamped on publish, so they can skip or repeat entities there.
+    */
+    class OwnedBucket {
+    public:
+        OwnedBucket(const OwnedBucket&) = delete;
+        OwnedBucket& operator=(const OwnedBucket&) = delete;
+
+        void add(T* e) {
+#ifdef CACHEIT_STATS
+            ++adds_;
+#endif
+            apply(e, true);
+        }
+
+        void remove(T* e) {
+#ifdef CACHEIT_STATS
+            ++removes_;
+#endif
+            apply(e, false);
+        }
+
+        void publish() {
+            auto& c = cache_;
+            std::vector<std::pair<T*, bool>> forwarded;
+            if (forwarded_.load(std::memory_order_relaxed)) {
+                auto lock = c.write_lock(c.grouping_mutex_);
+                forwarded.swap(inbox_);
+                forwarded_.store(false, std::memory_order_relaxed);
+            }
+            for (auto const& [e, add] : forwarded) apply(e, add);
+            {
+                auto lock = c.write_lock(c.grouping_mutex_);
+                publish_locked(forwarded);
+            }
+            // staging_ is the previously published vector now
+            for (auto const& [e, add] : ops_) stage(e, add);
+            ops_.clear();
+        }
+
+        // staged size, published or not
+        size_t size() const { return staging_.size(); }
+
+    private:
+        friend class CacheIt;
+
+        OwnedBucket(CacheIt& cache, const Category& cat) : cache_(cache), cat_(cat) {}
+
+        bool stage(T* e, bool add) {
+            if (add) {
+                staging_.push_back(e);
+                return true;
+            }
+            auto pos = std::find(staging_.begin(), staging_.end(), e);
+            if (pos == staging_.end()) return false;
+            std::swap(*pos, staging_.back());
+            staging_.pop_back();
+            return true;
+        }
+
+        void apply(T* e, bool add) {
+            if (!stage(e, add)) return;
+            ops_.emplace_back(e, add);
+            if (cache_.delta_enabled_.load(std::memory_order_relaxed))
+                log_.emplace_back(add ? delta_add : delta_remove, static_cast<u64>(e->id));
+        }
+
+        // any thread, called under the cache's unique lock
+        void post(T* e, bool add) {
+            inbox_.emplace_back(e, add);
+            forwarded_.store(true, std::memory_order_relaxed);
+        }
+
+        void publish_locked(const std::vector<std::pair<T*, bool>>& forwarded) {
+            auto& c = cache_;
+            auto it = c.category_to_index_.find(cat_);
+            if (generation_ != c.generation_) {
+                // rebuilt or cleared since the last publish: unpublished edits are dropped and this
+                // frame's forwarded ops go on top of what's there now (a full copy, but so was the rebuild)
+                generation_ = c.generation_;
+                staging_ = it != c.category_to_index_.end() ? c.buckets_[it->second] : std::vector<T*>{};
+                ops_.clear();
+                log_.clear();
+                for (auto const& [e, add] : forwarded) apply(e, add);
+            }
+
+            if (it == c.category_to_index_.end() && !staging_.empty()) {
+                it = c.category_to_index_.emplace(cat_, c.categories_.size()).first;
+                c.categories_.push_back(cat_);
+                c.buckets_.emplace_back();
+            }
+            if (it != c.category_to_index_.end()) {
+                size_t idx = it->second;
+                c.buckets_[idx].swap(staging_);
+                size_t n = c.buckets_[idx].size();
+                for (auto* cur : c.cursors_) {
+                    if (cur->generation_ == c.generation_ && cur->bucket_ == idx && cur->pos_ > n)
+                        cur->pos_ = n;
+                }
+                c.bump_bucket(idx);
+            } else {
+                // nothing to publish, staging_ is already the (empty) published state
+                ops_.clear();
+            }
+            for (auto const& [op, id] : log_) c.log_op(op, id);
+            log_.clear();
+#ifdef CACHEIT_STATS
+            c.stats_.adds.fetch_add(adds_, std::memory_order_relaxed);
+            c.stats_.removes.fetch_add(removes_, std::memory_order_relaxed);
+            adds_ = removes_ = 0;
+#endif
+        }
+
+        CacheIt& cache_;
+        const Category cat_;
+        std::vector<T*> staging_;
+        std::vector<std::pair<T*, bool>> ops_; // applied since the last publish, replayed after the swap
+        u64 generation_ = 0;
+        std::vector<std::pair<uint8_t, u64>> log_;
+        std::vector<std::pair<T*, bool>> inbox_; // guarded by grouping_mutex_
+        std::atomic<bool> forwarded_{false};
+#ifdef CACHEIT_STATS
+        u64 adds_ = 0, removes_ = 0;
+#endif
+    };
+
+    // binds cat to the calling thread, throws if it already has an owner
+    OwnedBucket& own(const Category& cat) {
+        static_assert(grouping_enabled, "own() needs grouping mode");
+        auto lock = write_lock(grouping_mutex_);
+        auto& slot = owned_[cat];
+        if (slot) throw std::logic_error("CacheIt::own: category already has an owner");
+        slot.reset(new OwnedBucket(*this, cat));
+        if (auto it = category_to_index_.find(cat); it != category_to_index_.end())
+            slot->staging_ = buckets_[it->second];
+        slot->generation_ = generation_;
+        return *slot;
+    }
+
+    // publishes and releases cat, call it from the owning thread
+    void disown(const Category& cat) {
+        static_assert(grouping_enabled, "disown() needs grouping mode");
+        OwnedBucket* owner = nullptr;
+        {
+            auto lock = read_lock(grouping_mutex_);
+            if (auto it = owned_.find(cat); it != owned_.end()) owner = it->second.get();
+        }
+        if (!owner) return;
+        owner->publish();
+
+        auto lock = write_lock(grouping_mutex_);
+        auto it = owned_.find(cat);
+        std::unique_ptr<OwnedBucket> gone = std::move(it->second);
+        owned_.erase(it);
+        // forwarded after the publish, these go straight in now
+        for (auto const& [e, add] : gone->inbox_) {
+            if (add) add_locked(e, cat);
+            else remove_locked(e, cat);
         }
     }
 
     void clear() {
         if constexpr (grouping_enabled) {
-            std::unique_lock lock(grouping_mutex_);
+            auto lock = write_lock(grouping_mutex_);
             category_to_index_.clear();
             categories_.clear();
             buckets_.clear();
+            bump_all_buckets();
+            ++generation_;
+            log_clear();
         } else {
-            std::unique_lock lock(id_mutex_);
+            auto lock = write_lock(id_mutex_);
             table_.clear();
             active_ids_.clear();
             id_to_index_.clear();
+            ++generation_;
+            mirror_all();
+            log_clear();
         }
     }
 
     size_t size() const {
         if constexpr (grouping_enabled) {
-            std::shared_lock lock(grouping_mutex_);
+            auto lock = read_lock(grouping_mutex_);
             size_t total = 0;
             for (auto const& b : buckets_) total += b.size();
             return total;
         } else {
-            std::shared_lock lock(id_mutex_);
+            auto lock = read_lock(id_mutex_);
             return active_ids_.size();
         }
     }
 
+    // O(1) lookup by id (ID mode only), nullptr if not cached
+    T* find(u64 id) const {
+        static_assert(!grouping_enabled, "find only in ID mode");
+        auto lock = read_lock(id_mutex_);
+        return id < table_.size() ? table_[id] : nullptr;
+    }
+
     std::vector<T*> get_all() const {
         std::vector<T*> result;
         if constexpr (grouping_enabled) {
-            std::shared_lock lock(grouping_mutex_);
+            auto lock = read_lock(grouping_mutex_);
             size_t total = 0;
             for (auto const& b : buckets_) total += b.size();
             result.reserve(total);
@@ -211,7 +856,7 @@ public:
                 for (auto* e : b)
                     result.push_back(e);
         } else {
-            std::shared_lock lock(id_mutex_);
+            auto lock = read_lock(id_mutex_);
             result.reserve(active_ids_.size());
             for (auto id : active_ids_)
                 if (id < table_.size() && table_[id])
@@ -221,46 +866,896 @@ public:
     }
 
     // iterate single category (grouping only)
-    template<typename Fn>
-    void for_each(const Category& cat, Fn func) const {
+    // callbacks run on a copy, outside the lock. Copies of small buckets (up to tls_view_limit)
+    // are kept per thread and reused while the bucket's version is unchanged, so repeated reads
+    // of an unchanged small category take no lock and copy nothing
+    template<typename K, typename Fn>
+    void for_each(const K& cat, Fn func) const {
         static_assert(grouping_enabled, "for_each only in grouping mode");
+        auto& views = tls_views();
+        for (auto& v : views.slots) {
+            if (v.instance == instance_id_ && v.version == v.version_slot->load(std::memory_order_acquire) &&
+                keys_equal(*v.cat, cat)) {
+                auto data = v.data; // keeps the view alive if func reenters and evicts this slot
+                for (auto* e : *data) func(e);
+                return;
+            }
+        }
+
         std::vector<T*> local;
+        std::shared_ptr<const std::vector<T*>> view;
+        {
+            auto lock = read_lock(grouping_mutex_);
+            auto it = find_category(cat);
+            if (it == category_to_index_.end()) return;
+            auto const& bucket = buckets_[it->second];
+            if (bucket.size() <= tls_view_limit) {
+                view = std::make_shared<const std::vector<T*>>(bucket);
+                auto& slot = views.slots[views.next++ % TlsViews::count];
+                slot.instance = instance_id_;
+                slot.cat.emplace(categories_[it->second]);
+                slot.version_slot = &bucket_versions_[it->second];
+                slot.version = slot.version_slot->load(std::memory_order_relaxed);
+                slot.data = view;
+            } else {
+                local = bucket;
+            }
+        }
+        if (view) for (auto* e : *view) func(e);
+        else for (auto* e : local) func(e);
+    }
+
+    static constexpr size_t tls_view_limit = 64;
+
+#ifdef CACHEIT_HAS_COROUTINES
+    /*
+    * Coroutine iteration (C++20) over a snapshot taken when it's called, no lock is held while
+    * iterating, so the consumer can suspend between entities (e.g. around network writes):
+        for (AActor* a : cache.co_iterate("Player")) { ... }
+    */
+    template<typename K>
+    CacheItGenerator<T*> co_iterate(const K& cat) const {
+        static_assert(grouping_enabled, "co_iterate only in grouping mode");
+        std::vector<T*> snapshot;
         {
-            std::shared_lock lock(grouping_mutex_);
-            auto it = category_to_index_.find(cat);
-            if (it != category_to_index_.end())
-                local = buckets_[it->second];
+            auto lock = read_lock(grouping_mutex_);
+            auto it = find_category(cat);
+            if (it != category_to_index_.end()) snapshot = buckets_[it->second];
+        }
+        return iterate_snapshot(std::move(snapshot));
+    }
+
+    CacheItGenerator<T*> co_iterate_all() const {
+        return iterate_snapshot(get_all());
+    }
+#endif
+
+    // k distinct uniformly random entities of a category (grouping only), returns min(k, bucket size)
+    // Floyd's algorithm straight over the bucket, out must have room for k, nothing is allocated.
+    // the "already picked" check scans out, which is cheaper than a set for the small k this is for
+    template<typename K, typename URBG>
+    size_t sample(const K& cat, size_t k, URBG& rng, T** out) const {
+        static_assert(grouping_enabled, "sample only in grouping mode");
+        auto lock = read_lock(grouping_mutex_);
+        auto it = find_category(cat);
+        if (it == category_to_index_.end()) return 0;
+        auto const& vec = buckets_[it->second];
+        size_t n = vec.size();
+        if (k > n) k = n;
+        size_t count = 0;
+        for (size_t j = n - k; j < n; ++j) {
+            T* pick = vec[std::uniform_int_distribution<size_t>(0, j)(rng)];
+            if (std::find(out, out + count, pick) != out + count) pick = vec[j];
+            out[count++] = pick;
         }
-        for (auto* e : local) func(e);
+        return count;
     }
 
     // iterate all
     template<typename Fn>
-    void for_each_all(Fn func) const {
+    void for_each_all(Fn func, CacheItCallSite site = CacheItCallSite::current()) const {
+        HoldWatch watch(*this, "for_each_all", site);
         if constexpr (grouping_enabled) {
-            std::shared_lock lock(grouping_mutex_);
+            auto lock = read_lock(grouping_mutex_);
+            watch.start();
             for (auto const& b : buckets_)
                 for (auto* e : b) func(e);
         } else {
-            std::shared_lock lock(id_mutex_);
+            auto lock = read_lock(id_mutex_);
+            watch.start();
             for (auto* e : table_) if (e) func(e);
         }
     }
 
+    // iterate several categories under one shared lock (grouping only), duplicates are visited once
+    template<typename K = Category, typename Fn>
+    void for_each_in(std::initializer_list<K> cats, Fn func,
+                     CacheItCallSite site = CacheItCallSite::current()) const {
+        static_assert(grouping_enabled, "for_each_in only in grouping mode");
+        HoldWatch watch(*this, "for_each_in", site);
+        auto lock = read_lock(grouping_mutex_);
+        watch.start();
+        std::vector<size_t> selected;
+        selected.reserve(cats.size());
+        for (auto const& c : cats) {
+            auto it = find_category(c);
+            if (it != category_to_index_.end() &&
+                std::find(selected.begin(), selected.end(), it->second) == selected.end())
+                selected.push_back(it->second);
+        }
+        for (size_t idx : selected) sweep(buckets_[idx], func);
+    }
+
+    // iterate every category except the given ones under one shared lock (grouping only)
+    template<typename K = Category, typename Fn>
+    void for_each_all_except(std::initializer_list<K> cats, Fn func,
+                             CacheItCallSite site = CacheItCallSite::current()) const {
+        static_assert(grouping_enabled, "for_each_all_except only in grouping mode");
+        HoldWatch watch(*this, "for_each_all_except", site);
+        auto lock = read_lock(grouping_mutex_);
+        watch.start();
+        std::vector<size_t> skip;
+        skip.reserve(cats.size());
+        for (auto const& c : cats) {
+            auto it = find_category(c);
+            if (it != category_to_index_.end()) skip.push_back(it->second);
+        }
+        for (size_t i = 0; i < buckets_.size(); ++i)
+            if (std::find(skip.begin(), skip.end(), i) == skip.end())
+                sweep(buckets_[i], func);
+    }
+
     // access active ids (ID mode only)
     const std::vector<u64>& active_ids() const {
         static_assert(!grouping_enabled, "active_ids only in ID mode");
-        std::shared_lock lock(id_mutex_);
+        auto lock = read_lock(id_mutex_);
         return active_ids_;
     }
 
+    // fn(a, b) for every id cached in both this and other (ID mode only), a comes from this cache.
+    // both caches are shared-locked together so it's one consistent view of each, the smaller
+    // side's active ids are walked and looked up directly in the other's table
+    template<typename U, typename C2, typename Cz2, typename H2, typename E2, typename Fn>
+    void join(const CacheIt<U, C2, Cz2, H2, E2>& other, Fn fn,
+              CacheItCallSite site = CacheItCallSite::current()) const {
+        static_assert(!grouping_enabled && !CacheIt<U, C2, Cz2, H2, E2>::grouping_enabled,
+                      "join only in ID mode");
+        HoldWatch watch(*this, "join", site);
+        auto locks = read_lock_both(other);
+        watch.start();
+
+        auto const& other_table = other.table_;
+        if (active_ids_.size() <= other.active_ids_.size()) {
+            for (u64 id : active_ids_)
+                if (id < other_table.size() && table_[id] && other_table[id])
+                    fn(table_[id], other_table[id]);
+        } else {
+            for (u64 id : other.active_ids_)
+                if (id < table_.size() && table_[id] && other_table[id])
+                    fn(table_[id], other_table[id]);
+        }
+    }
+
+    /*
+    * Persistent round-robin position over the whole cache or one category.
+    * It registers itself with the cache so remove() keeps it valid (swap-and-pop
+    * never moves an unvisited entity behind it), and a full rebuild restarts the round.
+        decltype(cache)::Cursor ai_cursor(cache, "Enemy");
+        // every frame:
+        cache.for_each_budgeted(ai_cursor, std::chrono::steady_clock::now() + 1ms, tick_ai);
+    * Must not outlive the cache, and one cursor shouldn't be driven by two threads at once.
+    */
+    class Cursor {
+    public:
+        explicit Cursor(const CacheIt& cache) : cache_(&cache) { cache_->register_cursor(this); }
+
+        Cursor(const CacheIt& cache, const Category& cat) : cache_(&cache), cat_(cat) {
+            static_assert(grouping_enabled, "category cursor only in grouping mode");
+            cache_->register_cursor(this);
+        }
+
+        ~Cursor() { cache_->unregister_cursor(this); }
+
+        Cursor(const Cursor&) = delete;
+        Cursor& operator=(const Cursor&) = delete;
+
+        // number of completed rounds
+        size_t rounds() const { return rounds_; }
+
+    private:
+        friend class CacheIt;
+        static constexpr size_t npos = SIZE_MAX;
+
+        const CacheIt* cache_;
+        std::optional<Category> cat_;
+        u64 generation_ = 0;
+        size_t bucket_ = npos; // bucket being swept (grouping), npos until first resolved
+        size_t pos_ = 0;       // [0, pos_) of the current sequence is visited
+        size_t rounds_ = 0;
+    };
+
+    // visits at most max_items from where the cursor stopped, returns true when the round completed
+    template<typename Fn>
+    bool for_each_budgeted(Cursor& cur, size_t max_items, Fn func,
+                           CacheItCallSite site = CacheItCallSite::current()) const {
+        return budgeted_impl(cur, max_items, {}, false, func, site);
+    }
+
+    // visits until the deadline passes, returns true when the round completed
+    template<typename Fn>
+    bool for_each_budgeted(Cursor& cur, std::chrono::steady_clock::time_point deadline, Fn func,
+                           CacheItCallSite site = CacheItCallSite::current()) const {
+        return budgeted_impl(cur, SIZE_MAX, deadline, true, func, site);
+    }
+
+    /*
+    * Lock-hold watchdog: once a budget is set, every call that runs callbacks under the shared
+    * lock (for_each_all, for_each_in, for_each_all_except, for_each_budgeted, join) is timed from
+    * lock acquisition to release. Calls over budget are kept in a small ring with their call site
+    * and passed to the hook (after the lock is released). A zero budget turns it off.
+        cache.set_lock_watchdog(std::chrono::microseconds(200), [](const CacheItLockHold& h) {
+            log("%s:%u held the cache lock for %lld ns", h.file, h.line, (long long)h.held.count());
+        });
+    */
+    void set_lock_watchdog(std::chrono::nanoseconds budget,
+                           std::function<void(const CacheItLockHold&)> hook = {}) {
+        std::lock_guard lock(watchdog_.mutex);
+        watchdog_.hook = std::move(hook);
+        watchdog_.budget_ns.store(budget.count(), std::memory_order_relaxed);
+    }
+
+    // over-budget holds still in the ring, oldest first
+    std::vector<CacheItLockHold> lock_watchdog_records() const {
+        std::lock_guard lock(watchdog_.mutex);
+        std::vector<CacheItLockHold> out;
+        size_t count = std::min(watchdog_.next, Watchdog::capacity);
+        for (size_t i = watchdog_.next - count; i < watchdog_.next; ++i)
+            out.push_back(watchdog_.ring[i % Watchdog::capacity]);
+        return out;
+    }
+
+    /*
+    * Replication: with the delta log on, every add/remove/update/clear is also encoded
+    * into a byte log (ids only, varint) that a CacheItFollower can apply to its own cache.
+    * Ship take_delta() output over whatever pipe/socket you like. A follower that joins late
+    * needs a keyframe taken at the same point the log is drained:
+        cache.take_delta(to_everyone, to_new_follower);
+    * then gets everything after that from the next take_delta() like the rest.
+    */
+    void enable_delta_log(bool on) {
+        auto lock = write_lock(mode_mutex());
+        delta_enabled_.store(on, std::memory_order_relaxed);
+        if (!on) {
+            delta_log_.clear();
+            deferred_reset_.clear();
+            has_deferred_reset_ = false;
+        }
+    }
+
+    // appends everything logged since the last call to out
+    void take_delta(std::vector<uint8_t>& out) {
+        take_delta_impl(out, nullptr);
+    }
+
+    // same, plus the state right after those records as a single reset in keyframe_out
+    void take_delta(std::vector<uint8_t>& out, std::vector<uint8_t>& keyframe_out) {
+        take_delta_impl(out, &keyframe_out);
+    }
+
+    // appends the current state as a single reset record to out. it isn't tied to a point in the
+    // delta log (records not drained yet are in it and would be applied twice), with the log on
+    // use take_delta(out, keyframe_out)
+    void keyframe(std::vector<uint8_t>& out) const {
+        std::vector<u64> ids;
+        {
+            auto lock = read_lock(mode_mutex());
+            snapshot_ids(ids);
+        }
+        encode_reset_ids(ids, out);
+    }
+
+    // delta record tags: add <id>, remove <id>, reset <count> <sorted id gaps, 0 = same id again...>
+    static constexpr uint8_t delta_add = 1;
+    static constexpr uint8_t delta_remove = 2;
+    static constexpr uint8_t delta_reset = 3;
+
+#ifdef CACHEIT_STATS
+    // point-in-time copy of the counters plus sizes, for CacheItExporter
+    CacheItStats stats() const {
+        CacheItStats st;
+        st.updates = stats_.updates.load(std::memory_order_relaxed);
+        st.adds = stats_.adds.load(std::memory_order_relaxed);
+        st.removes = stats_.removes.load(std::memory_order_relaxed);
+        stats_.read_wait.copy_to(st.read_wait);
+        stats_.write_wait.copy_to(st.write_wait);
+
+        // sizes come from the writers' relaxed mirrors, never from the cache lock. label_mutex_ is
+        // only contended by writers adding a category or rebuilding
+        st.size = total_size_.load(std::memory_order_relaxed);
+        st.memory_bytes = fixed_bytes_.load(std::memory_order_relaxed);
+        if constexpr (grouping_enabled) {
+            std::lock_guard lock(label_mutex_);
+            for (size_t i = 0; i < labels_.size(); ++i) {
+                auto const& slot = bucket_sizes_[i];
+                st.memory_bytes += slot.capacity.load(std::memory_order_relaxed) * sizeof(T*);
+                st.categories.emplace_back(labels_[i], slot.size.load(std::memory_order_relaxed));
+            }
+        }
+        return st;
+    }
+#endif
+
 private:
-    // functor
+    template<typename, typename, typename, typename, typename>
+    friend class CacheIt;
+
+    struct Watchdog {
+        static constexpr size_t capacity = 64;
+        std::atomic<int64_t> budget_ns{0};
+        mutable std::mutex mutex; // only taken to configure, read records or report a violation
+        std::function<void(const CacheItLockHold&)> hook;
+        CacheItLockHold ring[capacity] = {};
+        size_t next = 0;
+    };
+
+    // declared before the lock it watches, so it's destroyed (and reports) after the lock is released
+    class HoldWatch {
+    public:
+        HoldWatch(const CacheIt& cache, const char* op, const CacheItCallSite& site)
+            : cache_(cache), op_(op), site_(site) {}
+
+        void start() {
+            if (cache_.watchdog_.budget_ns.load(std::memory_order_relaxed) > 0)
+                start_ = std::chrono::steady_clock::now();
+        }
+
+        ~HoldWatch() {
+            if (start_ == std::chrono::steady_clock::time_point{}) return;
+            auto held = std::chrono::steady_clock::now() - start_;
+            auto& wd = cache_.watchdog_;
+            int64_t budget = wd.budget_ns.load(std::memory_order_relaxed);
+            if (budget <= 0 || held <= std::chrono::nanoseconds(budget)) return;
+
+            CacheItLockHold rec{op_, site_.file_name(), site_.function_name(), site_.line(),
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(held)};
+            std::function<void(const CacheItLockHold&)> hook;
+            {
+                std::lock_guard lock(wd.mutex);
+                wd.ring[wd.next % Watchdog::capacity] = rec;
+                ++wd.next;
+                hook = wd.hook;
+            }
+            if (hook) hook(rec);
+        }
+
+        HoldWatch(const HoldWatch&) = delete;
+        HoldWatch& operator=(const HoldWatch&) = delete;
+
+    private:
+        const CacheIt& cache_;
+        const char* op_;
+        const CacheItCallSite& site_;
+        std::chrono::steady_clock::time_point start_{};
+    };
+
+    // every lock in the cache goes through these (or read_lock_both) so stats/tracing can time the wait
+    std::unique_lock<std::shared_mutex> write_lock(std::shared_mutex& m) const {
+#ifdef CACHEIT_TRACE
+        CACHEIT_TRACE_SPAN(&m == &grouping_mutex_ ? "grouping_mutex_.wait_write" : "id_mutex_.wait_write");
+#endif
+#ifdef CACHEIT_STATS
+        auto t0 = std::chrono::steady_clock::now();
+        std::unique_lock<std::shared_mutex> lock(m);
+        stats_.write_wait.record(std::chrono::steady_clock::now() - t0);
+        return lock;
+#else
+        return std::unique_lock<std::shared_mutex>(m);
+#endif
+    }
+
+    std::shared_lock<std::shared_mutex> read_lock(std::shared_mutex& m) const {
+#ifdef CACHEIT_TRACE
+        CACHEIT_TRACE_SPAN(&m == &grouping_mutex_ ? "grouping_mutex_.wait_read" : "id_mutex_.wait_read");
+#endif
+#ifdef CACHEIT_STATS
+        auto t0 = std::chrono::steady_clock::now();
+        std::shared_lock<std::shared_mutex> lock(m);
+        stats_.read_wait.record(std::chrono::steady_clock::now() - t0);
+        return lock;
+#else
+        return std::shared_lock<std::shared_mutex>(m);
+#endif
+    }
+
+    // join's two shared locks, taken together with std::lock so opposite-order joins can't deadlock.
+    // timed like read_lock, the wait is recorded in both caches
+    template<typename Other>
+    std::pair<std::shared_lock<std::shared_mutex>, std::shared_lock<std::shared_mutex>>
+    read_lock_both(const Other& other) const {
+        CACHEIT_TRACE_SPAN("id_mutex_.wait_read");
+        bool same = static_cast<const void*>(this) == static_cast<const void*>(&other);
+#ifdef CACHEIT_STATS
+        auto t0 = std::chrono::steady_clock::now();
+#endif
+        std::shared_lock<std::shared_mutex> la(id_mutex_, std::defer_lock);
+        std::shared_lock<std::shared_mutex> lb(other.id_mutex_, std::defer_lock);
+        if (same) la.lock();
+        else std::lock(la, lb);
+#ifdef CACHEIT_STATS
+        auto waited = std::chrono::steady_clock::now() - t0;
+        stats_.read_wait.record(waited);
+        if (!same) other.stats_.read_wait.record(waited);
+#endif
+        return {std::move(la), std::move(lb)};
+    }
+
+#ifdef CACHEIT_STATS
+    static std::string category_label(const Category& c, size_t idx) {
+        if constexpr (std::is_convertible_v<const Category&, std::string_view>) return std::string(std::string_view(c));
+        else if constexpr (std::is_arithmetic_v<Category>) return std::to_string(c);
+        else if constexpr (std::is_enum_v<Category>) return std::to_string(static_cast<std::underlying_type_t<Category>>(c));
+        else return "#" + std::to_string(idx);
+    }
+#endif
+
+    static void put_varint(std::vector<uint8_t>& out, u64 v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    // ids are sorted so the reset is a run of small gaps. duplicates are kept (a gap of 0):
+    // grouping add() doesn't dedupe, so a follower needs the same multiplicity as the leader
+    static void encode_reset_ids(std::vector<u64>& ids, std::vector<uint8_t>& out) {
+        std::sort(ids.begin(), ids.end());
+        out.push_back(delta_reset);
+        put_varint(out, ids.size());
+        u64 prev = 0;
+        for (u64 id : ids) {
+            put_varint(out, id - prev);
+            prev = id;
+        }
+    }
+
+    // called under either lock
+    void snapshot_ids(std::vector<u64>& ids) const {
+        if constexpr (grouping_enabled) {
+            for (auto const& b : buckets_)
+                for (auto* e : b) ids.push_back(static_cast<u64>(e->id));
+        } else {
+            ids = active_ids_;
+        }
+    }
+
+    void take_delta_impl(std::vector<uint8_t>& out, std::vector<uint8_t>* keyframe_out) {
+        std::vector<u64> reset, snapshot;
+        std::vector<uint8_t> log;
+        bool has_reset;
+        {
+            auto lock = write_lock(mode_mutex());
+            has_reset = std::exchange(has_deferred_reset_, false);
+            reset.swap(deferred_reset_);
+            log.swap(delta_log_);
+            if (keyframe_out) snapshot_ids(snapshot);
+        }
+        // resets from update()/step()/clear() are sorted and encoded here, off the writer's path
+        if (has_reset) encode_reset_ids(reset, out);
+        out.insert(out.end(), log.begin(), log.end());
+        if (keyframe_out) encode_reset_ids(snapshot, *keyframe_out);
+    }
+
+    // the rest are called under the unique lock
+    void log_op(uint8_t op, u64 id) {
+        if (!delta_enabled_.load(std::memory_order_relaxed)) return;
+        delta_log_.push_back(op);
+        put_varint(delta_log_, id);
+    }
+
+    void log_clear() {
+        std::vector<u64> none;
+        defer_reset(none);
+    }
+
+    // a reset supersedes everything logged before it, so the log is dropped and the
+    // ids are kept as they are until take_delta() encodes them
+    void defer_reset(std::vector<u64>& ids) {
+        if (!delta_enabled_.load(std::memory_order_relaxed)) return;
+        delta_log_.clear();
+        deferred_reset_.swap(ids);
+        has_deferred_reset_ = true;
+    }
+
+    template<typename H, typename = void>
+    struct is_transparent : std::false_type {};
+    template<typename H>
+    struct is_transparent<H, std::void_t<typename H::is_transparent>> : std::true_type {};
+
+#if defined(__cpp_lib_generic_unordered_lookup)
+    static constexpr bool heterogeneous_lookup = is_transparent<Hash>::value && is_transparent<KeyEqual>::value;
+#else
+    static constexpr bool heterogeneous_lookup = false;
+#endif
+
+    // category_to_index_ lookup by anything a Category can be compared with or built from
+    template<typename K>
+    auto find_category(const K& key) const {
+        if constexpr (heterogeneous_lookup || std::is_same_v<K, Category>)
+            return category_to_index_.find(key);
+        else
+            return category_to_index_.find(Category(key));
+    }
+
+    // add/remove bodies, called with the mode's unique lock held
+    void add_locked(T* e, const stored_category& c) {
+        u64 id = static_cast<u64>(e->id);
+        if constexpr (grouping_enabled) {
+            if (!owned_.empty()) {
+                if (auto o = owned_.find(c); o != owned_.end()) return o->second->post(e, true);
+            }
+            auto it = category_to_index_.find(c);
+            if (it == category_to_index_.end()) {
+                it = category_to_index_.emplace(c, categories_.size()).first;
+                categories_.push_back(c);
+                buckets_.emplace_back();
+            }
+            size_t idx = it->second;
+            buckets_[idx].push_back(e);
+            bump_bucket(idx);
+            log_op(delta_add, id);
+        } else {
+            if (id_to_index_.count(id)) return; // avoid duplicates
+            if (id >= table_.size())
+                table_.resize(id + 1, nullptr);
+            table_[id] = e;
+            size_t pos = active_ids_.size();
+            active_ids_.push_back(id);
+            id_to_index_[id] = pos;
+            mirror_all();
+            log_op(delta_add, id);
+        }
+    }
+
+    void remove_locked(T* e, const stored_category& c) {
+        u64 id = static_cast<u64>(e->id);
+        if constexpr (grouping_enabled) {
+            if (!owned_.empty()) {
+                if (auto o = owned_.find(c); o != owned_.end()) return o->second->post(e, false);
+            }
+            auto it = category_to_index_.find(c);
+            if (it == category_to_index_.end()) return;
+            auto& vec = buckets_[it->second];
+            if (auto pos = std::find(vec.begin(), vec.end(), e); pos != vec.end()) {
+                size_t idx = fixup_cursors(it->second, pos - vec.begin(), [&](size_t a, size_t b) {
+                    std::swap(vec[a], vec[b]);
+                });
+                std::swap(vec[idx], vec.back());
+                vec.pop_back();
+                bump_bucket(it->second);
+                log_op(delta_remove, id);
+            }
+        } else {
+            auto it = id_to_index_.find(id);
+            if (it == id_to_index_.end()) return;
+            size_t idx = fixup_cursors(0, it->second, [&](size_t a, size_t b) {
+                std::swap(active_ids_[a], active_ids_[b]);
+                id_to_index_[active_ids_[a]] = a;
+                id_to_index_[active_ids_[b]] = b;
+            });
+            size_t last = active_ids_.size() - 1;
+            u64 back_id = active_ids_[last];
+            std::swap(active_ids_[idx], active_ids_[last]);
+            active_ids_.pop_back();
+            id_to_index_[back_id] = idx;
+            id_to_index_.erase(it);
+            if (id < table_.size()) table_[id] = nullptr;
+            mirror_all();
+            log_op(delta_remove, id);
+        }
+    }
+
+#ifdef CACHEIT_HAS_COROUTINES
+    // the snapshot is a coroutine parameter, so it lives in the (pooled) frame
+    static CacheItGenerator<T*> iterate_snapshot(std::vector<T*> snapshot) {
+        for (auto* e : snapshot) co_yield e;
+    }
+#endif
+
+    template<typename K>
+    static bool keys_equal(const Category& a, const K& b) {
+        if constexpr (is_transparent<KeyEqual>::value || std::is_same_v<K, Category>) return KeyEqual{}(a, b);
+        else return KeyEqual{}(a, Category(b));
+    }
+
+    // per-thread copies of small buckets for for_each, shared by every cache of this type
+    struct TlsView {
+        u64 instance = 0; // 0 = empty slot, instance ids start at 1
+        std::optional<Category> cat;
+        const std::atomic<u64>* version_slot = nullptr;
+        u64 version = 0;
+        std::shared_ptr<const std::vector<T*>> data;
+    };
+
+    struct TlsViews {
+        static constexpr size_t count = 8;
+        TlsView slots[count];
+        size_t next = 0;
+    };
+
+    static TlsViews& tls_views() {
+        thread_local TlsViews views;
+        return views;
+    }
+
+    static u64 next_instance_id() {
+        static std::atomic<u64> next{1};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // called under the unique lock whenever a bucket's contents change
+    void bump_bucket(size_t idx) {
+        if constexpr (grouping_enabled) {
+            while (bucket_versions_.size() <= idx) bucket_versions_.emplace_back(0);
+            bucket_versions_[idx].fetch_add(1, std::memory_order_release);
+            mirror_bucket(idx);
+        }
+    }
+
+    // after a rebuild/clear every index may now name a different category
+    void bump_all_buckets() {
+        if constexpr (grouping_enabled) {
+            while (bucket_versions_.size() < buckets_.size()) bucket_versions_.emplace_back(0);
+            for (auto& v : bucket_versions_) v.fetch_add(1, std::memory_order_release);
+        }
+        mirror_all();
+    }
+
+    // stats() reads sizes from these mirrors instead of taking the cache lock,
+    // they're refreshed under the unique lock the writer already holds
+    void mirror_bucket([[maybe_unused]] size_t idx) {
+#ifdef CACHEIT_STATS
+        if (idx >= labels_.size()) return mirror_all(); // new category
+        auto& slot = bucket_sizes_[idx];
+        u64 n = buckets_[idx].size();
+        total_size_.fetch_add(n - slot.size.exchange(n, std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.capacity.store(buckets_[idx].capacity(), std::memory_order_relaxed);
+#endif
+    }
+
+    void mirror_all() {
+#ifdef CACHEIT_STATS
+        if constexpr (grouping_enabled) {
+            std::lock_guard lock(label_mutex_);
+            labels_.resize(categories_.size());
+            while (bucket_sizes_.size() < buckets_.size()) bucket_sizes_.emplace_back();
+            u64 total = 0;
+            for (size_t i = 0; i < buckets_.size(); ++i) {
+                labels_[i] = category_label(categories_[i], i);
+                bucket_sizes_[i].size.store(buckets_[i].size(), std::memory_order_relaxed);
+                bucket_sizes_[i].capacity.store(buckets_[i].capacity(), std::memory_order_relaxed);
+                total += buckets_[i].size();
+            }
+            total_size_.store(total, std::memory_order_relaxed);
+            fixed_bytes_.store(buckets_.capacity() * sizeof(std::vector<T*>)
+                             + categories_.capacity() * sizeof(Category)
+                             + category_to_index_.bucket_count() * sizeof(void*)
+                             + category_to_index_.size() * (sizeof(Category) + 2 * sizeof(size_t)),
+                               std::memory_order_relaxed);
+        } else {
+            total_size_.store(active_ids_.size(), std::memory_order_relaxed);
+            fixed_bytes_.store(table_.capacity() * sizeof(T*)
+                             + active_ids_.capacity() * sizeof(u64)
+                             + id_to_index_.bucket_count() * sizeof(void*)
+                             + id_to_index_.size() * (sizeof(u64) + 2 * sizeof(size_t)),
+                               std::memory_order_relaxed);
+        }
+#endif
+    }
+
+    // bucket sweep that prefetches the entity a few slots ahead of the callback
+    template<typename Fn>
+    static void sweep(const std::vector<T*>& bucket, Fn& func) {
+        constexpr size_t ahead = 4;
+        size_t n = bucket.size();
+        for (size_t i = 0; i < n; ++i) {
+            if (i + ahead < n) CACHEIT_PREFETCH(bucket[i + ahead]);
+            func(bucket[i]);
+        }
+    }
+
+    template<typename Fn>
+    bool budgeted_impl(Cursor& cur, size_t max_items, std::chrono::steady_clock::time_point deadline,
+                       bool timed, Fn& func, const CacheItCallSite& site) const {
+        HoldWatch watch(*this, "for_each_budgeted", site);
+        auto lock = read_lock(mode_mutex());
+        watch.start();
+        if (cur.generation_ != generation_) {
+            cur.generation_ = generation_;
+            cur.bucket_ = Cursor::npos;
+            cur.pos_ = 0;
+        }
+
+        auto finish_round = [&] {
+            cur.pos_ = 0;
+            cur.bucket_ = Cursor::npos;
+            ++cur.rounds_;
+            return true;
+        };
+
+        // the clock is only read every 16 items
+        size_t n = 0;
+        auto out_of_budget = [&] {
+            if (n >= max_items) return true;
+            return timed && (n & 15) == 0 && std::chrono::steady_clock::now() >= deadline;
+        };
+
+        if constexpr (grouping_enabled) {
+            if (cur.cat_) {
+                auto it = find_category(*cur.cat_);
+                if (it == category_to_index_.end()) return finish_round();
+                cur.bucket_ = it->second;
+                auto const& vec = buckets_[cur.bucket_];
+                while (cur.pos_ < vec.size()) {
+                    if (out_of_budget()) return false;
+                    func(vec[cur.pos_++]);
+                    ++n;
+                }
+                return finish_round();
+            }
+            if (cur.bucket_ == Cursor::npos) cur.bucket_ = 0;
+            for (; cur.bucket_ < buckets_.size(); ++cur.bucket_, cur.pos_ = 0) {
+                auto const& vec = buckets_[cur.bucket_];
+                while (cur.pos_ < vec.size()) {
+                    if (out_of_budget()) return false;
+                    func(vec[cur.pos_++]);
+                    ++n;
+                }
+            }
+            return finish_round();
+        } else {
+            cur.bucket_ = 0;
+            while (cur.pos_ < active_ids_.size()) {
+                if (out_of_budget()) return false;
+                u64 id = active_ids_[cur.pos_++];
+                if (id < table_.size() && table_[id]) func(table_[id]);
+                ++n;
+            }
+            return finish_round();
+        }
+    }
+
+    std::shared_mutex& mode_mutex() const {
+        if constexpr (grouping_enabled) return grouping_mutex_;
+        else return id_mutex_;
+    }
+
+    void register_cursor(Cursor* c) const {
+        auto lock = write_lock(mode_mutex());
+        c->generation_ = generation_;
+        if constexpr (grouping_enabled) {
+            if (c->cat_) {
+                auto it = find_category(*c->cat_);
+                if (it != category_to_index_.end()) c->bucket_ = it->second;
+            }
+        } else {
+            c->bucket_ = 0;
+        }
+        cursors_.push_back(c);
+    }
+
+    void unregister_cursor(Cursor* c) const {
+        auto lock = write_lock(mode_mutex());
+        cursors_.erase(std::find(cursors_.begin(), cursors_.end(), c));
+    }
+
+    // Called under the unique lock before slot idx of a sequence (a bucket, or active_ids_)
+    // is swap-and-popped. Cursors past idx are walked in ascending order: each steps back by
+    // one and the removed entity is swapped onto its boundary slot, so no cursor's visited
+    // prefix ever receives an unvisited entity. Returns the slot that now holds the removed entity.
+    template<typename Swap>
+    size_t fixup_cursors(size_t bucket, size_t idx, Swap swap_slots) {
+        for (;;) {
+            Cursor* next = nullptr;
+            for (auto* c : cursors_) {
+                if (c->generation_ != generation_ || c->bucket_ != bucket || c->pos_ <= idx) continue;
+                if (!next || c->pos_ < next->pos_) next = c;
+            }
+            if (!next) return idx;
+            --next->pos_;
+            if (next->pos_ != idx) swap_slots(idx, next->pos_);
+            idx = next->pos_;
+        }
+    }
+
+    // in-flight state of a time-sliced rebuild, owned by the writer thread
+    struct PendingUpdate {
+        std::vector<T*> entities;
+        size_t pos = 0;
+        bool active = false;
+        // grouping
+        category_map index;
+        std::vector<Category> categories;
+        std::vector<std::vector<T*>> buckets;
+        // ID
+        std::vector<T*> table;
+        std::vector<u64> ids;
+        std::unordered_map<u64, size_t> idx_map;
+        // delta log: ids gathered slice by slice for the reset record
+        bool log = false;
+        std::vector<u64> delta_ids;
+    };
+
+    bool step_impl(size_t max_entities, std::chrono::steady_clock::time_point deadline, bool timed) {
+        if (!pending_.active) return false;
+        auto& p = pending_;
+        size_t end = p.entities.size() - p.pos > max_entities ? p.pos + max_entities : p.entities.size();
+
+        // single pass (no categorize-then-reserve like update()), the clock is only read every 64 entities
+        while (p.pos < end) {
+            size_t chunk_end = std::min(end, p.pos + 64);
+            for (; p.pos < chunk_end; ++p.pos) {
+                T* e = p.entities[p.pos];
+                if (p.log) p.delta_ids.push_back(static_cast<u64>(e->id));
+                if constexpr (grouping_enabled) {
+                    Category c = categorizer_(e);
+                    auto it = p.index.find(c);
+                    if (it == p.index.end()) {
+                        it = p.index.emplace(c, p.categories.size()).first;
+                        p.categories.push_back(c);
+                        p.buckets.emplace_back();
+                    }
+                    p.buckets[it->second].push_back(e);
+                } else {
+                    u64 id = static_cast<u64>(e->id);
+                    if (id >= p.table.size())
+                        p.table.resize(id + 1, nullptr);
+                    p.table[id] = e;
+                    size_t pos = p.ids.size();
+                    p.ids.push_back(id);
+                    p.idx_map[id] = pos;
+                }
+            }
+            if (timed && std::chrono::steady_clock::now() >= deadline) break;
+        }
+        if (p.pos < p.entities.size()) return false;
+
+        // publish, old state is destroyed after the lock is released
+        CACHEIT_COUNT(updates);
+        PendingUpdate done = std::move(pending_);
+        pending_ = PendingUpdate{};
+        // the reset record isn't encoded here (that's a sort over every id), take_delta() does it
+        if (!done.log && delta_enabled_.load(std::memory_order_relaxed)) {
+            // log switched on mid-pass
+            done.delta_ids.reserve(done.entities.size());
+            for (auto* e : done.entities) done.delta_ids.push_back(static_cast<u64>(e->id));
+        }
+        if constexpr (grouping_enabled) {
+            auto lock = write_lock(grouping_mutex_);
+            category_to_index_.swap(done.index);
+            categories_.swap(done.categories);
+            buckets_.swap(done.buckets);
+            bump_all_buckets();
+            ++generation_;
+            defer_reset(done.delta_ids);
+        } else {
+            auto lock = write_lock(id_mutex_);
+            table_.swap(done.table);
+            active_ids_.swap(done.ids);
+            id_to_index_.swap(done.idx_map);
+            ++generation_;
+            mirror_all();
+            defer_reset(done.delta_ids);
+        }
+        return true;
+    }
+
+    // functor
     std::conditional_t<std::is_same_v<Categorizer, void>, char, Categorizer> categorizer_;
     
     // grouping
     mutable std::shared_mutex grouping_mutex_;
-    std::unordered_map<Category, size_t> category_to_index_;
+    category_map category_to_index_;
     std::vector<Category> categories_;
     std::vector<std::vector<T*>> buckets_;
     
@@ -269,4 +1764,412 @@ private:
     std::vector<T*> table_;
     std::vector<u64> active_ids_;
     std::unordered_map<u64, size_t> id_to_index_;
+
+    // time-sliced update
+    PendingUpdate pending_;
+
+    // bumped by every full rebuild/clear (guarded by the mode's mutex), restarts cursor rounds
+    u64 generation_ = 0;
+    mutable std::vector<Cursor*> cursors_;
+
+    // thread-owned categories (guarded by grouping_mutex_)
+    std::unordered_map<Category, std::unique_ptr<OwnedBucket>, Hash, KeyEqual> owned_;
+
+#ifdef CACHEIT_STATS
+    struct Counters {
+        std::atomic<u64> updates{0}, adds{0}, removes{0};
+        CacheItLockHistogram read_wait, write_wait;
+    };
+    mutable Counters stats_;
+
+    // size mirrors for stats(), labels_/bucket_sizes_ only grow under label_mutex_
+    struct SizeSlot {
+        std::atomic<u64> size{0}, capacity{0};
+    };
+    mutable std::mutex label_mutex_;
+    std::vector<std::string> labels_;
+    std::deque<SizeSlot> bucket_sizes_;
+    std::atomic<u64> total_size_{0}, fixed_bytes_{0};
+#endif
+
+    mutable Watchdog watchdog_;
+
+    // for_each's per-thread views, version slots are never removed so views can hold pointers to them
+    const u64 instance_id_ = next_instance_id();
+    std::deque<std::atomic<u64>> bucket_versions_;
+
+    // replication (delta_log_ and the deferred reset guarded by the mode's mutex)
+    std::atomic<bool> delta_enabled_{false};
+    std::vector<uint8_t> delta_log_;
+    std::vector<u64> deferred_reset_; // goes before delta_log_ in the next take_delta()
+    bool has_deferred_reset_ = false;
+};
+
+// join(a, b, fn) == a.join(b, fn)
+template<typename T1, typename C1, typename Z1, typename H1, typename E1,
+         typename T2, typename C2, typename Z2, typename H2, typename E2, typename Fn>
+void join(const CacheIt<T1, C1, Z1, H1, E1>& a, const CacheIt<T2, C2, Z2, H2, E2>& b, Fn fn,
+          CacheItCallSite site = CacheItCallSite::current()) {
+    a.join(b, std::move(fn), site);
+}
+
+/*
+* Read-through front for an ID mode cache that sits in front of a slower store.
+    auto load = [&](const std::vector<uint64_t>& ids, std::vector<AActor*>& out) {
+        // out is already sized like ids, leave nullptr for ids the store doesn't have
+    };
+    CacheItReadThrough<AActor, decltype(load)> rt(cache, load);
+    AActor* a = rt.get(id);          // hit, or nullptr and the id is queued
+    auto f = rt.get_async(id);       // shared_future, resolved by the tick that fetches it
+    rt.tick();                       // once per frame: one loader call for everything queued
+* Concurrent misses for one id share the same fetch, ids the store didn't have are
+* remembered as missing until forget_missing()/clear_missing().
+*/
+template<typename T, typename Loader, typename Cache = CacheIt<T>>
+class CacheItReadThrough {
+public:
+    using u64 = uint64_t;
+
+    CacheItReadThrough(Cache& cache, Loader loader)
+        : cache_(cache), loader_(std::move(loader)) {}
+
+    std::shared_future<T*> get_async(u64 id) {
+        if (T* e = cache_.find(id)) return ready(e);
+        std::lock_guard lock(mutex_);
+        if (missing_.count(id)) return ready(nullptr);
+        auto it = inflight_.find(id);
+        if (it == inflight_.end()) {
+            // re-check, a tick may have added it between find() and taking the lock
+            if (T* e = cache_.find(id)) return ready(e);
+            it = inflight_.emplace(id, Flight{}).first;
+            it->second.future = it->second.promise.get_future().share();
+            queued_.push_back(id);
+        }
+        return it->second.future;
+    }
+
+    T* get(u64 id) {
+        if (T* e = cache_.find(id)) return e;
+        get_async(id);
+        return nullptr;
+    }
+
+    // fetches everything queued since the last tick in one loader call, returns the batch size
+    size_t tick() {
+        std::vector<u64> batch;
+        {
+            std::lock_guard lock(mutex_);
+            batch.swap(queued_);
+        }
+        if (batch.empty()) return 0;
+
+        std::vector<T*> out(batch.size(), nullptr);
+        try {
+            loader_(static_cast<const std::vector<u64>&>(batch), out);
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            for (u64 id : batch) {
+                auto it = inflight_.find(id);
+                it->second.promise.set_exception(std::current_exception());
+                inflight_.erase(it);
+            }
+            throw;
+        }
+
+        // add before resolving so a concurrent get() sees either the flight or the hit
+        for (T* e : out)
+            if (e) cache_.add(e);
+
+        std::lock_guard lock(mutex_);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!out[i]) missing_.insert(batch[i]);
+            auto it = inflight_.find(batch[i]);
+            it->second.promise.set_value(out[i]);
+            inflight_.erase(it);
+        }
+        return batch.size();
+    }
+
+    void forget_missing(u64 id) {
+        std::lock_guard lock(mutex_);
+        missing_.erase(id);
+    }
+
+    void clear_missing() {
+        std::lock_guard lock(mutex_);
+        missing_.clear();
+    }
+
+private:
+    struct Flight {
+        std::promise<T*> promise;
+        std::shared_future<T*> future;
+    };
+
+    static std::shared_future<T*> ready(T* e) {
+        std::promise<T*> p;
+        p.set_value(e);
+        return p.get_future().share();
+    }
+
+    Cache& cache_;
+    Loader loader_;
+    std::mutex mutex_;
+    std::unordered_map<u64, Flight> inflight_;
+    std::vector<u64> queued_;
+    std::unordered_set<u64> missing_;
+};
+
+/*
+* Applies a CacheIt delta stream to a follower cache. The leader only sends ids, resolve(id)
+* returns the follower's own entity for it (nullptr to skip ids it doesn't know).
+    CacheItFollower follower(mirror, [&](uint64_t id) { return world.find(id); });
+    size_t used = follower.apply(buf.data(), buf.size());  // keep buf[used..] for the next read
+* A grouping mode follower recategorizes with its own categorizer, so only ids go over the wire.
+*/
+template<typename Cache, typename Resolver>
+class CacheItFollower {
+public:
+    using u64 = uint64_t;
+
+    CacheItFollower(Cache& cache, Resolver resolve)
+        : cache_(cache), resolve_(std::move(resolve)) {}
+
+    // applies every complete record in data, returns the bytes consumed
+    // (a record cut off at the end is left for the next call)
+    size_t apply(const uint8_t* data, size_t len) {
+        size_t pos = 0;
+        while (pos < len) {
+            size_t p = pos + 1;
+            u64 v;
+            if (!get_varint(data, len, p, v)) break;
+            uint8_t op = data[pos];
+            if (op == Cache::delta_add || op == Cache::delta_remove) {
+                if (auto* e = resolve_(v)) {
+                    if (op == Cache::delta_add) cache_.add(e);
+                    else cache_.remove(e);
+                }
+            } else if (op == Cache::delta_reset) {
+                reset_.clear();
+                u64 id = 0;
+                bool complete = true;
+                for (u64 i = 0; i < v; ++i) {
+                    u64 gap;
+                    if (!get_varint(data, len, p, gap)) { complete = false; break; }
+                    id += gap;
+                    if (auto* e = resolve_(id)) reset_.push_back(e);
+                }
+                if (!complete) break;
+                cache_.update(reset_);
+            } else {
+                throw std::runtime_error("CacheItFollower: unknown delta record");
+            }
+            pos = p;
+        }
+        return pos;
+    }
+
+private:
+    static bool get_varint(const uint8_t* data, size_t len, size_t& pos, u64& v) {
+        v = 0;
+        for (int shift = 0; pos < len && shift < 64; shift += 7) {
+            uint8_t b = data[pos++];
+            v |= static_cast<u64>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        if (pos < len) throw std::runtime_error("CacheItFollower: malformed varint");
+        return false;
+    }
+
+    Cache& cache_;
+    Resolver resolve_;
+    std::vector<typename Cache::value_type*> reset_;
+};
+
+#ifdef CACHEIT_STATS
+/*
+* Renders registered caches in OpenMetrics text format, one label set per cache name:
+    CacheItExporter exporter;
+    exporter.add("actors", actor_cache);
+    exporter.write("/var/lib/node_exporter/cacheit.prom");  // or serve exporter.render() yourself
+    exporter.remove("actors");                                // before actor_cache goes away
+* The exporter keeps a reference to every added cache, so a cache has to be removed
+* (or outlive the exporter) before it's destroyed.
+*/
+class CacheItExporter {
+public:
+    template<typename Cache>
+    void add(std::string name, const Cache& cache) {
+        std::lock_guard lock(mutex_);
+        sources_.push_back({std::move(name), [&cache] { return cache.stats(); }});
+    }
+
+    // unregisters every cache added under name, returns false if there was none.
+    // waits for a render() in progress, so the cache can be destroyed right after
+    bool remove(const std::string& name) {
+        std::lock_guard lock(mutex_);
+        auto it = std::remove_if(sources_.begin(), sources_.end(),
+                                 [&](auto const& s) { return s.name == name; });
+        bool found = it != sources_.end();
+        sources_.erase(it, sources_.end());
+        return found;
+    }
+
+    std::string render() const {
+        std::vector<std::pair<std::string, CacheItStats>> all;
+        {
+            std::lock_guard lock(mutex_);
+            for (auto const& s : sources_) all.emplace_back(escape(s.name), s.collect());
+        }
+
+        std::string out;
+        auto family = [&](const char* name, const char* type, const char* help) {
+            out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+            out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+        };
+        auto sample = [&](const std::string& name, const std::string& labels, uint64_t v) {
+            out += name; out += '{'; out += labels; out += "} "; out += std::to_string(v); out += '\n';
+        };
+        auto cache_label = [](const std::string& n) { return "cache=\"" + n + "\""; };
+
+        family("cacheit_size", "gauge", "Entities currently cached.");
+        for (auto const& [n, st] : all) sample("cacheit_size", cache_label(n), st.size);
+
+        family("cacheit_category_size", "gauge", "Entities per category (grouping mode).");
+        for (auto const& [n, st] : all)
+            for (auto const& [cat, size] : st.categories)
+                sample("cacheit_category_size", cache_label(n) + ",category=\"" + escape(cat) + "\"", size);
+
+        family("cacheit_memory_bytes", "gauge", "Estimated memory held by the cache's containers.");
+        for (auto const& [n, st] : all) sample("cacheit_memory_bytes", cache_label(n), st.memory_bytes);
+
+        const char* ops[] = {"update", "add", "remove"};
+        family("cacheit_operations", "counter", "Mutating operations by kind.");
+        for (auto const& [n, st] : all) {
+            uint64_t v[] = {st.updates, st.adds, st.removes};
+            for (size_t i = 0; i < 3; ++i)
+                sample("cacheit_operations_total", cache_label(n) + ",op=\"" + ops[i] + "\"", v[i]);
+        }
+
+        family("cacheit_lock_wait_seconds", "histogram", "Time spent waiting to acquire the cache lock.");
+        for (auto const& [n, st] : all) {
+            histogram(out, cache_label(n) + ",mode=\"read\"", st.read_wait);
+            histogram(out, cache_label(n) + ",mode=\"write\"", st.write_wait);
+        }
+
+        out += "# EOF\n";
+        return out;
+    }
+
+    // writes to a temp file and renames it over path so scrapers never see half a file
+    bool write(const std::string& path) const {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+            if (!f) return false;
+            f << render();
+            if (!f) return false;
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct Source {
+        std::string name;
+        std::function<CacheItStats()> collect;
+    };
+
+    static std::string escape(const std::string& s) {
+        std::string r;
+        for (char c : s) {
+            if (c == '\\') r += "\\\\";
+            else if (c == '"') r += "\\\"";
+            else if (c == '\n') r += "\\n";
+            else r += c;
+        }
+        return r;
+    }
+
+    static void histogram(std::string& out, const std::string& labels, const CacheItLockHistogram::Snapshot& h) {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= CacheItLockHistogram::buckets; ++i) {
+            cumulative += h.counts[i];
+            std::string le = i < CacheItLockHistogram::buckets
+                ? seconds(CacheItLockHistogram::bounds_ns[i]) : std::string("+Inf");
+            out += "cacheit_lock_wait_seconds_bucket{" + labels + ",le=\"" + le + "\"} "
+                 + std::to_string(cumulative) + '\n';
+        }
+        out += "cacheit_lock_wait_seconds_count{" + labels + "} " + std::to_string(cumulative) + '\n';
+        out += "cacheit_lock_wait_seconds_sum{" + labels + "} " + seconds(h.sum_ns) + '\n';
+    }
+
+    static std::string seconds(uint64_t ns) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(ns) / 1e9);
+        return buf;
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<Source> sources_;
+};
+#endif
+
+/*
+* Drives per-category work in priority order under a frame deadline (grouping mode):
+    CacheItScheduler sched(grp_cache);
+    sched.add("Player", 10, [](AActor* a) { ... });
+    sched.add("Ambient", 1, [](AActor* a) { ... });
+    // every frame:
+    sched.run(std::chrono::steady_clock::now() + std::chrono::milliseconds(2));
+* Each category runs one full round per frame. Whatever the deadline cuts off resumes next frame
+* from its cursor, and every frame a category doesn't finish adds 1 to its priority until it does,
+* so low priorities can't starve. Watchdog records point at the add() that registered the work.
+*/
+template<typename Cache>
+class CacheItScheduler {
+public:
+    using T = typename Cache::value_type;
+    using Category = typename Cache::category_type;
+
+    explicit CacheItScheduler(const Cache& cache) : cache_(cache) {}
+
+    void add(const Category& cat, int priority, std::function<void(T*)> fn,
+             CacheItCallSite site = CacheItCallSite::current()) {
+        entries_.push_back(std::make_unique<Entry>(cache_, cat, priority, std::move(fn), site));
+    }
+
+    // returns true when every category finished its round before the deadline
+    bool run(std::chrono::steady_clock::time_point deadline) {
+        order_.clear();
+        for (auto& e : entries_) order_.push_back(e.get());
+        std::stable_sort(order_.begin(), order_.end(), [](const Entry* a, const Entry* b) {
+            return a->priority + a->age > b->priority + b->age;
+        });
+
+        bool all_done = true;
+        for (Entry* e : order_) {
+            bool done = std::chrono::steady_clock::now() < deadline &&
+                        cache_.for_each_budgeted(e->cursor, deadline, e->fn, e->site);
+            e->age = done ? 0 : e->age + 1;
+            all_done = all_done && done;
+        }
+        return all_done;
+    }
+
+private:
+    struct Entry {
+        Entry(const Cache& cache, const Category& cat, int prio, std::function<void(T*)> f,
+              CacheItCallSite s)
+            : cursor(cache, cat), priority(prio), fn(std::move(f)), site(s) {}
+
+        typename Cache::Cursor cursor;
+        int priority;
+        int age = 0;
+        std::function<void(T*)> fn;
+        CacheItCallSite site;
+    };
+
+    const Cache& cache_;
+    std::vector<std::unique_ptr<Entry>> entries_;
+    std::vector<Entry*> order_;
 };
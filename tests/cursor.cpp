@@ -0,0 +1,127 @@
+// Cursor / for_each_budgeted() against a reference model: every entity cached for a whole round
+// is visited exactly once, however add/remove interleave with the budgeted steps.
+// g++ -std=c++17 -pthread tests/cursor.cpp -o cursor && ./cursor
+#include "../CacheIt.hpp"
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <set>
+
+struct AActor {
+    int id;
+    std::string ActorType;
+};
+
+static auto type_cat = [](const AActor* actor) { return actor->ActorType; };
+
+// one round per cursor tracked on the side
+template<typename Cache>
+struct Round {
+    typename Cache::Cursor cursor;
+    std::optional<std::string> cat;
+    std::set<int> stable;           // cached at round start and not removed since
+    std::map<int, int> visits;
+
+    Round(Cache& cache) : cursor(cache) {}
+    Round(Cache& cache, const std::string& c) : cursor(cache, c), cat(c) {}
+
+    bool covers(const AActor& a) const { return !cat || a.ActorType == *cat; }
+
+    void start(const std::vector<AActor>& world, const std::vector<char>& cached) {
+        stable.clear();
+        visits.clear();
+        for (auto& a : world)
+            if (cached[a.id] && covers(a)) stable.insert(a.id);
+    }
+
+    void check() const {
+        for (int id : stable) assert(visits.count(id) && visits.at(id) == 1);
+    }
+};
+
+template<typename Cache, typename... Cats>
+void fuzz(Cache& cache, std::vector<AActor>& world, std::mt19937& rng, bool timed) {
+    std::vector<AActor*> all;
+    for (auto& a : world) all.push_back(&a);
+    cache.update(all);
+    std::vector<char> cached(world.size(), 1);
+
+    std::vector<std::unique_ptr<Round<Cache>>> rounds;
+    rounds.push_back(std::make_unique<Round<Cache>>(cache));
+    rounds.push_back(std::make_unique<Round<Cache>>(cache));
+    if constexpr (sizeof...(Cats) > 0) {
+        for (const char* c : {Cats::value...}) {
+            rounds.push_back(std::make_unique<Round<Cache>>(cache, c));
+            rounds.push_back(std::make_unique<Round<Cache>>(cache, c));
+        }
+    }
+    for (auto& r : rounds) r->start(world, cached);
+
+    size_t completed = 0;
+    while (completed < 300) {
+        // one budgeted step for a random cursor
+        auto& r = *rounds[rng() % rounds.size()];
+        auto visit = [&](AActor* a) {
+            assert(cached[a->id] && r.covers(*a));
+            ++r.visits[a->id];
+        };
+        bool done = timed ? cache.for_each_budgeted(r.cursor, std::chrono::steady_clock::now() +
+                                                    std::chrono::microseconds(rng() % 20), visit)
+                          : cache.for_each_budgeted(r.cursor, size_t(rng() % 8), visit);
+        if (done) {
+            r.check();
+            r.start(world, cached);
+            ++completed;
+        }
+
+        // interleaved churn, no duplicates so membership stays a set
+        for (int k = 0; k < 3; ++k) {
+            AActor* a = all[rng() % all.size()];
+            if (cached[a->id]) {
+                cache.remove(a);
+                cached[a->id] = 0;
+                for (auto& other : rounds) other->stable.erase(a->id);
+            } else {
+                cache.add(a);
+                cached[a->id] = 1;
+            }
+        }
+    }
+    for (auto& r : rounds) assert(r->cursor.rounds() > 0);
+}
+
+struct Player { static constexpr const char* value = "Player"; };
+struct Enemy { static constexpr const char* value = "Enemy"; };
+
+int main() {
+    std::vector<AActor> world;
+    const char* types[] = {"Player", "Enemy", "NPC"};
+    for (int i = 0; i < 300; ++i) world.push_back({i, types[i % 3]});
+    std::mt19937 rng(3);
+
+    for (bool timed : {false, true}) {
+        CacheIt<AActor> id_cache;
+        fuzz(id_cache, world, rng, timed);
+
+        CacheIt<AActor, std::string, decltype(type_cat)> grp_cache(type_cat);
+        fuzz<decltype(grp_cache), Player, Enemy>(grp_cache, world, rng, timed);
+    }
+
+    // update() restarts the round: the next round covers exactly the new state
+    CacheIt<AActor> id_cache;
+    std::vector<AActor*> first, second;
+    for (int i = 0; i < 100; ++i) first.push_back(&world[i]);
+    for (int i = 200; i < 250; ++i) second.push_back(&world[i]);
+    id_cache.update(first);
+    decltype(id_cache)::Cursor cursor(id_cache);
+    assert(!id_cache.for_each_budgeted(cursor, 10, [](AActor*) {}));
+    id_cache.update(second);
+    std::set<int> seen;
+    while (!id_cache.for_each_budgeted(cursor, 7, [&](AActor* a) { assert(seen.insert(a->id).second); })) {}
+    assert(seen.size() == 50 && *seen.begin() == 200);
+
+    std::cout << "cursor ok\n";
+}
@@ -0,0 +1,152 @@
+// Thread-owned categories: after every publish() the shared bucket has to match a model of the
+// owner's staged ops plus the ops forwarded from other threads, across mid-frame rebuilds.
+// g++ -std=c++17 -pthread tests/owned.cpp -o owned && ./owned
+#include "../CacheIt.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+struct AActor {
+    int id;
+    std::string ActorType;
+};
+
+static auto type_cat = [](const AActor* actor) { return actor->ActorType; };
+using Cache = CacheIt<AActor, std::string, decltype(type_cat)>;
+
+static std::multiset<int> bucket(Cache& cache, const char* cat) {
+    std::multiset<int> out;
+    cache.for_each(cat, [&](AActor* a) { out.insert(a->id); });
+    return out;
+}
+
+static void apply(std::multiset<int>& model, int id, bool add) {
+    if (add) {
+        model.insert(id);
+    } else if (auto it = model.find(id); it != model.end()) {
+        model.erase(it);
+    }
+}
+
+// single thread, so the model is exact
+static void model_check(std::vector<AActor>& world) {
+    Cache cache(type_cat);
+    std::multiset<int> staged, published;
+    for (int i = 0; i < 20; ++i) {
+        cache.add(&world[i]);
+        staged.insert(i);
+    }
+    published = staged;
+
+    auto& players = cache.own("Player");
+    std::mt19937 rng(11);
+    std::vector<std::pair<int, bool>> forwarded; // land at the next publish, after the owner's own ops
+    for (int frame = 0; frame < 500; ++frame) {
+        for (int k = rng() % 20; k > 0; --k) {
+            int id = static_cast<int>(rng() % world.size());
+            bool add = rng() % 2;
+            if (rng() % 4 == 0) {
+                add ? cache.add(&world[id]) : cache.remove(&world[id]);
+                forwarded.emplace_back(id, add);
+            } else {
+                add ? players.add(&world[id]) : players.remove(&world[id]);
+                apply(staged, id, add);
+            }
+        }
+        assert(bucket(cache, "Player") == published); // nothing visible before publish()
+
+        if (frame % 97 == 96) {
+            // a rebuild wins over unpublished owner edits, forwarded ops still land on top of it
+            players.add(&world[299]);
+            std::vector<AActor*> fresh;
+            for (int i = 0; i < 50; ++i) fresh.push_back(&world[i]);
+            cache.update(fresh);
+            staged = std::multiset<int>();
+            for (auto* a : fresh) staged.insert(a->id);
+            for (auto [id, add] : forwarded) apply(staged, id, add);
+            forwarded.clear();
+        }
+
+        players.publish();
+        for (auto [id, add] : forwarded) apply(staged, id, add);
+        forwarded.clear();
+        published = staged;
+        assert(bucket(cache, "Player") == published);
+        assert(players.size() == published.size());
+    }
+
+    // disown publishes, then later adds go straight into the bucket
+    cache.add(&world[5]);
+    published.insert(5);
+    cache.disown("Player");
+    assert(bucket(cache, "Player") == published);
+    cache.add(&world[6]);
+    published.insert(6);
+    assert(bucket(cache, "Player") == published);
+}
+
+// owner, forwarding writer and reader on separate threads (run it under -fsanitize=thread too)
+static void threaded(std::vector<AActor>& world) {
+    std::vector<AActor> others;
+    for (int i = 0; i < 100; ++i) others.push_back({1000 + i, "Enemy"});
+    Cache cache(type_cat);
+    for (int i = 0; i < 10; ++i) cache.add(&world[i]);
+
+    std::atomic<bool> owned{false}, stop{false};
+    std::thread owner([&] {
+        auto& players = cache.own("Player");
+        owned = true;
+        for (int frame = 0; frame < 200; ++frame) {
+            players.add(&world[100 + frame]);
+            players.publish();
+        }
+        while (!stop) players.publish();
+        cache.disown("Player");
+    });
+    while (!owned) {}
+
+    // a second owner and transactions that touch an owned category are rejected, nothing applied
+    bool threw = false;
+    try { cache.own("Player"); } catch (const std::logic_error&) { threw = true; }
+    assert(threw);
+    auto tx = cache.transaction();
+    tx.add(&others[0]);
+    tx.add(&world[50]);
+    threw = false;
+    try { tx.commit(); } catch (const std::logic_error&) { threw = true; }
+    assert(threw && bucket(cache, "Enemy").empty());
+
+    std::thread writer([&] {
+        for (int i = 10; i < 60; ++i) cache.add(&world[i]);
+        for (int i = 10; i < 30; ++i) cache.remove(&world[i]);
+        for (auto& e : others) cache.add(&e);
+    });
+    std::thread reader([&] {
+        while (!stop)
+            cache.for_each("Player", [](AActor* a) { assert(a->ActorType == "Player"); });
+    });
+    writer.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    stop = true;
+    owner.join();
+    reader.join();
+
+    std::multiset<int> expected;
+    for (int i = 0; i < 10; ++i) expected.insert(i);
+    for (int i = 30; i < 60; ++i) expected.insert(i);
+    for (int i = 100; i < 300; ++i) expected.insert(i);
+    assert(bucket(cache, "Player") == expected);
+    assert(bucket(cache, "Enemy").size() == others.size());
+}
+
+int main() {
+    std::vector<AActor> world;
+    for (int i = 0; i < 300; ++i) world.push_back({i, "Player"});
+    model_check(world);
+    threaded(world);
+    std::cout << "owned ok\n";
+}
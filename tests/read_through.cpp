@@ -0,0 +1,82 @@
+// CacheItReadThrough against an in-process fake store.
+// g++ -std=c++17 -pthread tests/read_through.cpp -o read_through && ./read_through
+#include "../CacheIt.hpp"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+struct AActor {
+    int id;
+    float ActorHealth;
+};
+
+// the "slow store": knows ids below 100, can be told to fail the next batch
+struct FakeStore {
+    std::vector<AActor> actors;
+    std::vector<std::vector<uint64_t>> calls;
+    bool fail_next = false;
+
+    FakeStore() {
+        for (int i = 0; i < 100; ++i) actors.push_back({i, 100.0f});
+    }
+
+    void load(const std::vector<uint64_t>& ids, std::vector<AActor*>& out) {
+        calls.push_back(ids);
+        if (fail_next) {
+            fail_next = false;
+            throw std::runtime_error("store down");
+        }
+        for (size_t i = 0; i < ids.size(); ++i)
+            if (ids[i] < actors.size()) out[i] = &actors[ids[i]];
+    }
+};
+
+int main() {
+    FakeStore store;
+    auto load = [&](const std::vector<uint64_t>& ids, std::vector<AActor*>& out) { store.load(ids, out); };
+    CacheIt<AActor> cache;
+    CacheItReadThrough<AActor, decltype(load)> rt(cache, load);
+
+    // single flight: concurrent misses for one id share a future and a single fetch
+    std::vector<std::shared_future<AActor*>> futures(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < futures.size(); ++i)
+        threads.emplace_back([&, i] { futures[i] = rt.get_async(42); });
+    for (auto& t : threads) t.join();
+    assert(rt.get(7) == nullptr); // queued alongside 42
+
+    assert(rt.tick() == 2);
+    assert(store.calls.size() == 1 && store.calls[0].size() == 2);
+    for (auto& f : futures) assert(f.get() == &store.actors[42]);
+    assert(cache.find(42) == &store.actors[42]);
+
+    // hits don't reach the store
+    assert(rt.get(42) == &store.actors[42] && rt.get(7) == &store.actors[7]);
+    assert(rt.tick() == 0 && store.calls.size() == 1);
+
+    // loader exceptions reach every waiter and tick(), nothing gets remembered as missing
+    store.fail_next = true;
+    auto failing = rt.get_async(50);
+    bool threw = false;
+    try { rt.tick(); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { failing.get(); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    assert(rt.get(50) == nullptr); // queued again
+    assert(rt.tick() == 1 && cache.find(50) == &store.actors[50]);
+
+    // negative caching: ids the store doesn't have are only asked for once
+    auto absent = rt.get_async(500);
+    size_t calls = store.calls.size();
+    assert(rt.tick() == 1 && absent.get() == nullptr);
+    assert(rt.get(500) == nullptr && rt.get_async(500).get() == nullptr);
+    assert(rt.tick() == 0 && store.calls.size() == calls + 1);
+
+    // until they're forgotten
+    rt.forget_missing(500);
+    assert(rt.get(500) == nullptr && rt.tick() == 1 && store.calls.size() == calls + 2);
+
+    std::cout << "read_through ok\n";
+}
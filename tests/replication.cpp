@@ -0,0 +1,136 @@
+// Delta log replication from a leader to followers over pipe()s.
+// g++ -std=c++17 -pthread tests/replication.cpp -o replication && ./replication
+#include "../CacheIt.hpp"
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <unistd.h>
+
+struct AActor {
+    int id;
+    std::string ActorType;
+};
+
+static std::vector<AActor> world;
+
+static auto type_cat = [](const AActor* actor) { return actor->ActorType; };
+using Cache = CacheIt<AActor, std::string, decltype(type_cat)>;
+
+// multiset of ids per category
+static std::map<std::string, std::multiset<int>> contents(Cache& cache) {
+    std::map<std::string, std::multiset<int>> out;
+    cache.for_each_all([&](AActor* a) { out[a->ActorType].insert(a->id); });
+    return out;
+}
+
+// reads its pipe in tiny chunks so records get split across reads
+struct Follower {
+    Cache mirror{type_cat};
+    int fds[2];
+    std::thread reader;
+
+    Follower() {
+        int rc = pipe(fds);
+        assert(rc == 0);
+        (void)rc;
+        reader = std::thread([this] {
+            CacheItFollower follower(mirror, [](uint64_t id) { return &world[id]; });
+            std::vector<uint8_t> buf;
+            uint8_t chunk[7];
+            ssize_t n;
+            while ((n = read(fds[0], chunk, sizeof(chunk))) > 0) {
+                buf.insert(buf.end(), chunk, chunk + n);
+                size_t used = follower.apply(buf.data(), buf.size());
+                buf.erase(buf.begin(), buf.begin() + used);
+            }
+            assert(buf.empty());
+            close(fds[0]);
+        });
+    }
+
+    void send(const std::vector<uint8_t>& bytes) {
+        size_t off = 0;
+        while (off < bytes.size()) {
+            ssize_t n = write(fds[1], bytes.data() + off, bytes.size() - off);
+            assert(n > 0);
+            off += static_cast<size_t>(n);
+        }
+    }
+
+    void finish() {
+        close(fds[1]);
+        reader.join();
+    }
+};
+
+int main() {
+    const char* types[] = {"Player", "Enemy", "NPC", "DroppedItem"};
+    for (int i = 0; i < 5000; ++i) world.push_back({i, types[i % 4]});
+    std::vector<AActor*> all;
+    for (auto& a : world) all.push_back(&a);
+
+    Cache leader(type_cat);
+    leader.enable_delta_log(true);
+    std::vector<std::unique_ptr<Follower>> followers;
+    followers.push_back(std::make_unique<Follower>());
+    followers.push_back(std::make_unique<Follower>());
+
+    auto frame = [&](std::vector<uint8_t>* keyframe = nullptr) {
+        std::vector<uint8_t> bytes;
+        if (keyframe) leader.take_delta(bytes, *keyframe);
+        else leader.take_delta(bytes);
+        for (auto& f : followers) f->send(bytes);
+    };
+
+    std::mt19937 rng(7);
+    auto churn = [&] {
+        for (int k = 0; k < 200; ++k) {
+            AActor* a = all[rng() % all.size()];
+            if (rng() % 3) leader.add(a); // grouping add doesn't dedupe, so duplicates get replicated too
+            else leader.remove(a);
+        }
+    };
+
+    leader.update(std::vector<AActor*>(all.begin(), all.begin() + 1000));
+    frame();
+    for (int f = 0; f < 10; ++f) {
+        churn();
+        frame();
+    }
+
+    // a time-sliced rebuild, published by a later step()
+    leader.begin_update(std::vector<AActor*>(all.begin() + 500, all.begin() + 3500));
+    while (!leader.step(size_t(700))) {
+        churn();
+        frame();
+    }
+    churn();
+    frame();
+
+    // late joiner: ops logged but not drained yet must not end up in its state twice
+    churn();
+    std::vector<uint8_t> keyframe;
+    frame(&keyframe);
+    followers.push_back(std::make_unique<Follower>());
+    followers.back()->send(keyframe);
+    for (int f = 0; f < 10; ++f) {
+        churn();
+        frame();
+    }
+
+    leader.clear();
+    churn();
+    frame();
+
+    auto expected = contents(leader);
+    for (auto& f : followers) {
+        f->finish();
+        assert(contents(f->mirror) == expected);
+        assert(f->mirror.size() == leader.size());
+    }
+    std::cout << "replication ok\n";
+}